@@ -0,0 +1,255 @@
+#ifndef EVALUATION_H
+#define EVALUATION_H
+
+#include <stdint.h>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+//Static evaluation of many positions at once.
+//
+//Positions are packed into bitboards, one 64 bit mask per side. Each column takes 7 bits,
+//6 for the rows and one empty sentinel bit on top so that lines can't wrap into the
+//next column. Bit (col * 7 + row) is the space at that row and col, row 0 is the bottom,
+//the same as Board::board.
+//
+//Every 4 space line on the board (a "window") is checked in all 4 directions:
+//   open three       - 3 of the side's spaces and 1 empty space
+//   open two         - 2 of the side's spaces and 2 empty spaces
+//   playable threat  - an open three whose empty space can be marked on the next move
+//
+//The same kernel runs on plain 64 bit integers, on 2 positions at a time with SSE2 or
+//on 4 positions at a time with AVX2, depending on what the compiler was told to target.
+
+//All the spaces on the board, not including the sentinel bits
+const uint64_t boardMask = 0x0FDFBF7EFDFBFULL;
+
+//The bottom row of every column
+const uint64_t bottomMask = 0x0040810204081ULL;
+
+//Counts for one side of one position
+struct ThreatCounts {
+    int openThrees;
+    int openTwos;
+    int playableThreats;
+};
+
+/*
+Function: cellBit
+Purpose: get the bit for a space on the packed board
+Arguments:  int - the row of the space
+            int - the col of the space
+Returns:    uint64_t - the mask with only that space set
+*/
+inline uint64_t cellBit(int row, int col) {
+    return (uint64_t) 1 << (col * 7 + row);
+}
+
+//Plain 64 bit integers, one position at a time
+struct ScalarLanes {
+    typedef uint64_t Vec;
+    static const int width = 1;
+
+    static Vec load(const uint64_t *p) { return *p; }
+    static void store(uint64_t *p, Vec a) { *p = a; }
+    static Vec set1(uint64_t x) { return x; }
+    static Vec bitAnd(Vec a, Vec b) { return a & b; }
+    static Vec bitOr(Vec a, Vec b) { return a | b; }
+    static Vec andNot(Vec a, Vec b) { return ~a & b; }
+    static Vec add(Vec a, Vec b) { return a + b; }
+    template <int N> static Vec shiftRight(Vec a) { return a >> N; }
+
+    //count the set bits of each byte, then add the bytes together
+    static Vec popcount(Vec a) {
+        a = a - ((a >> 1) & 0x5555555555555555ULL);
+        a = (a & 0x3333333333333333ULL) + ((a >> 2) & 0x3333333333333333ULL);
+        a = (a + (a >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return (a * 0x0101010101010101ULL) >> 56;
+    }
+};
+
+#if defined(__SSE2__) || defined(_M_X64)
+//SSE2, two positions at a time
+struct SseLanes {
+    typedef __m128i Vec;
+    static const int width = 2;
+
+    static Vec load(const uint64_t *p) { return _mm_loadu_si128((const __m128i *) p); }
+    static void store(uint64_t *p, Vec a) { _mm_storeu_si128((__m128i *) p, a); }
+    static Vec set1(uint64_t x) { return _mm_set1_epi64x((long long) x); }
+    static Vec bitAnd(Vec a, Vec b) { return _mm_and_si128(a, b); }
+    static Vec bitOr(Vec a, Vec b) { return _mm_or_si128(a, b); }
+    static Vec andNot(Vec a, Vec b) { return _mm_andnot_si128(a, b); }
+    static Vec add(Vec a, Vec b) { return _mm_add_epi64(a, b); }
+    template <int N> static Vec shiftRight(Vec a) { return _mm_srli_epi64(a, N); }
+
+    //same as the scalar version, but the bytes are summed with sad since
+    //there is no 64 bit multiply
+    static Vec popcount(Vec a) {
+        const Vec m1 = _mm_set1_epi8(0x55);
+        const Vec m2 = _mm_set1_epi8(0x33);
+        const Vec m4 = _mm_set1_epi8(0x0F);
+        a = _mm_sub_epi8(a, _mm_and_si128(_mm_srli_epi64(a, 1), m1));
+        a = _mm_add_epi8(_mm_and_si128(a, m2), _mm_and_si128(_mm_srli_epi64(a, 2), m2));
+        a = _mm_and_si128(_mm_add_epi8(a, _mm_srli_epi64(a, 4)), m4);
+        return _mm_sad_epu8(a, _mm_setzero_si128());
+    }
+};
+#endif
+
+#if defined(__AVX2__)
+//AVX2, four positions at a time
+struct Avx2Lanes {
+    typedef __m256i Vec;
+    static const int width = 4;
+
+    static Vec load(const uint64_t *p) { return _mm256_loadu_si256((const __m256i *) p); }
+    static void store(uint64_t *p, Vec a) { _mm256_storeu_si256((__m256i *) p, a); }
+    static Vec set1(uint64_t x) { return _mm256_set1_epi64x((long long) x); }
+    static Vec bitAnd(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+    static Vec bitOr(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+    static Vec andNot(Vec a, Vec b) { return _mm256_andnot_si256(a, b); }
+    static Vec add(Vec a, Vec b) { return _mm256_add_epi64(a, b); }
+    template <int N> static Vec shiftRight(Vec a) { return _mm256_srli_epi64(a, N); }
+
+    static Vec popcount(Vec a) {
+        const Vec m1 = _mm256_set1_epi8(0x55);
+        const Vec m2 = _mm256_set1_epi8(0x33);
+        const Vec m4 = _mm256_set1_epi8(0x0F);
+        a = _mm256_sub_epi8(a, _mm256_and_si256(_mm256_srli_epi64(a, 1), m1));
+        a = _mm256_add_epi8(_mm256_and_si256(a, m2), _mm256_and_si256(_mm256_srli_epi64(a, 2), m2));
+        a = _mm256_and_si256(_mm256_add_epi8(a, _mm256_srli_epi64(a, 4)), m4);
+        return _mm256_sad_epu8(a, _mm256_setzero_si256());
+    }
+};
+#endif
+
+/*
+Function: countDirection
+Purpose: count the windows in one direction for a vector of positions
+Arguments:  D - how far apart neighbouring spaces are on the packed board,
+                1 for vertical, 7 for horizontal, 6 and 8 for the diagonals
+            Vec - the side's spaces
+            Vec - the empty spaces
+            Vec - the spaces that can be marked next move
+            Vec& - running counts of open threes, open twos and playable threats
+Returns:    N/A
+Side Notes: windows that run off the board always include a sentinel or out of range bit,
+            which is never set in the side's spaces or the empty spaces, so they are never counted
+*/
+template <class L, int D>
+inline void countDirection(typename L::Vec mine, typename L::Vec empty, typename L::Vec playable,
+                           typename L::Vec &threes, typename L::Vec &twos, typename L::Vec &threats) {
+    typedef typename L::Vec Vec;
+
+    //the k-th space of every window, lined up with the window's first space
+    Vec m0 = mine;
+    Vec m1 = L::template shiftRight<D>(mine);
+    Vec m2 = L::template shiftRight<2 * D>(mine);
+    Vec m3 = L::template shiftRight<3 * D>(mine);
+
+    Vec e0 = empty;
+    Vec e1 = L::template shiftRight<D>(empty);
+    Vec e2 = L::template shiftRight<2 * D>(empty);
+    Vec e3 = L::template shiftRight<3 * D>(empty);
+
+    Vec p0 = playable;
+    Vec p1 = L::template shiftRight<D>(playable);
+    Vec p2 = L::template shiftRight<2 * D>(playable);
+    Vec p3 = L::template shiftRight<3 * D>(playable);
+
+    Vec m01 = L::bitAnd(m0, m1);
+    Vec m23 = L::bitAnd(m2, m3);
+
+    //3 marked, the empty space can be any of the 4.
+    //A window only matches one of the cases, so or-ing them counts each window once
+    Vec three = L::bitOr(L::bitOr(L::bitAnd(e0, L::bitAnd(m1, m23)), L::bitAnd(e1, L::bitAnd(m0, m23))),
+                         L::bitOr(L::bitAnd(e2, L::bitAnd(m01, m3)), L::bitAnd(e3, L::bitAnd(m01, m2))));
+
+    Vec threat = L::bitOr(L::bitOr(L::bitAnd(p0, L::bitAnd(m1, m23)), L::bitAnd(p1, L::bitAnd(m0, m23))),
+                          L::bitOr(L::bitAnd(p2, L::bitAnd(m01, m3)), L::bitAnd(p3, L::bitAnd(m01, m2))));
+
+    //2 marked and 2 empty, 6 ways to place them
+    Vec two = L::bitOr(L::bitOr(L::bitAnd(m01, L::bitAnd(e2, e3)), L::bitAnd(m23, L::bitAnd(e0, e1))),
+                       L::bitOr(L::bitAnd(L::bitAnd(m0, m2), L::bitAnd(e1, e3)),
+                                L::bitAnd(L::bitAnd(m1, m3), L::bitAnd(e0, e2))));
+    two = L::bitOr(two, L::bitOr(L::bitAnd(L::bitAnd(m0, m3), L::bitAnd(e1, e2)),
+                                 L::bitAnd(L::bitAnd(m1, m2), L::bitAnd(e0, e3))));
+
+    threes = L::add(threes, L::popcount(three));
+    twos = L::add(twos, L::popcount(two));
+    threats = L::add(threats, L::popcount(threat));
+}
+
+/*
+Function: evaluateBlock
+Purpose: count the threats for L::width positions
+Arguments:  uint64_t* - the spaces of the side being scored, one mask per position
+            uint64_t* - the spaces of the other side, one mask per position
+            ThreatCounts* - filled in with the counts for each position
+Returns:    N/A
+*/
+template <class L>
+inline void evaluateBlock(const uint64_t *mine, const uint64_t *theirs, ThreatCounts *out) {
+    typedef typename L::Vec Vec;
+
+    Vec me = L::load(mine);
+    Vec occupied = L::bitOr(me, L::load(theirs));
+    Vec board = L::set1(boardMask);
+
+    //empty spaces, and the lowest empty space of each column
+    //(adding the bottom row carries into the first empty space above each stack)
+    Vec empty = L::andNot(occupied, board);
+    Vec playable = L::bitAnd(L::add(occupied, L::set1(bottomMask)), board);
+
+    Vec threes = L::set1(0);
+    Vec twos = L::set1(0);
+    Vec threats = L::set1(0);
+
+    countDirection<L, 1>(me, empty, playable, threes, twos, threats);
+    countDirection<L, 7>(me, empty, playable, threes, twos, threats);
+    countDirection<L, 6>(me, empty, playable, threes, twos, threats);
+    countDirection<L, 8>(me, empty, playable, threes, twos, threats);
+
+    uint64_t threeCounts[L::width], twoCounts[L::width], threatCounts[L::width];
+    L::store(threeCounts, threes);
+    L::store(twoCounts, twos);
+    L::store(threatCounts, threats);
+
+    for (int i = 0; i < L::width; i++) {
+        out[i].openThrees = (int) threeCounts[i];
+        out[i].openTwos = (int) twoCounts[i];
+        out[i].playableThreats = (int) threatCounts[i];
+    }
+}
+
+/*
+Function: evaluatePositions
+Purpose: count open threes, open twos and playable threats for a batch of positions
+Arguments:  uint64_t* - the spaces of the side being scored, one mask per position
+            uint64_t* - the spaces of the other side, one mask per position
+            int - the number of positions
+            ThreatCounts* - filled in with the counts for each position
+Returns:    N/A
+Side Notes: uses the widest vector unit available and finishes the leftover
+            positions with the narrower ones
+*/
+inline void evaluatePositions(const uint64_t *mine, const uint64_t *theirs, int count, ThreatCounts *out) {
+    int i = 0;
+
+#if defined(__AVX2__)
+    for (; i + Avx2Lanes::width <= count; i += Avx2Lanes::width)
+        evaluateBlock<Avx2Lanes>(mine + i, theirs + i, out + i);
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64)
+    for (; i + SseLanes::width <= count; i += SseLanes::width)
+        evaluateBlock<SseLanes>(mine + i, theirs + i, out + i);
+#endif
+
+    for (; i < count; i++)
+        evaluateBlock<ScalarLanes>(mine + i, theirs + i, out + i);
+}
+
+#endif
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/types_c.h>
+#include <opencv2/core/hal/intrin.hpp>
 
 //Code sourced from https://www.opencv-srf.com/p/introduction.html
 
@@ -21,18 +22,18 @@ class Coordinate {
 };
 
 /*
-Function: calibratePlayerColor
-Purpose: get the HSV values for the color marker the player will be using.
-Arguments:     N/A
+Function: calibrateColor
+Purpose: get the HSV values for a color marker using trackbars.
+Arguments:     int* - the array of 8 values to fill in
 Returns:       int* - pointer to the first HSV value
 Side Notes:    the first and second values are lowHue and highHue
                the third and fourth values are lowSaturation and highSaturation
                the fifth and sixth values are lowVibrance and highVibrance
+               the seventh and eighth values are the width and height of the frame
 */
-int *calibratePlayerColor() {
+int *calibrateColor(int *hsvArray) {
      //Try to open camera
      VideoCapture cap(1); //might have to edit what cap is depending on what camera number your camera is 
-     static int hsvArray[8]; //the hsv array, which also includes values for the size of the screen
 
      //if it cant open the camera, return immediately
      if (!cap.isOpened()) 
@@ -125,11 +126,39 @@ int *calibratePlayerColor() {
      destroyAllWindows();
 }
 
+/*
+Function: calibratePlayerColor
+Purpose: get the HSV values for the color marker the player will be using.
+Arguments:     N/A
+Returns:       int* - pointer to the first HSV value, see calibrateColor
+*/
+int *calibratePlayerColor() {
+     static int hsvArray[8]; //the hsv array, which also includes values for the size of the screen
+
+     cout << "Calibrating the player's marker color." << endl;
+     return calibrateColor(hsvArray);
+}
+
+/*
+Function: calibrateRobotColor
+Purpose: get the HSV values for the color marker the robot will be using.
+Arguments:     N/A
+Returns:       int* - pointer to the first HSV value, see calibrateColor
+Side Notes:    kept in its own array so it doesn't overwrite the player's values
+*/
+int *calibrateRobotColor() {
+     static int hsvArray[8];
+
+     cout << "Calibrating the robot's marker color." << endl;
+     return calibrateColor(hsvArray);
+}
+
 /*
 Function: getImage
 Purpose: get an image of the game board, thresholded with HSV
 Arguments:  int* - the list of HSV values and the size of the screen
 Returns:     Mat - the new image of the game board
+Side Notes:  Deprecated, replaced by classifyFrame and the capture and vision stages in main.cpp
 */
 Mat getImage(int* hsvPtr) {
 
@@ -192,12 +221,179 @@ Mat getImage(int* hsvPtr) {
      }
 }
 
+//Fraction of a cell's pixels that have to match a color for the cell to count as marked
+const float minCellCoverage = 0.15f;
+
+/*
+Function: pixelInRange
+Purpose: determine if an HSV pixel falls inside a calibrated range
+Arguments:  Vec3b - the HSV pixel
+            int* - the list of HSV values, see calibrateColor
+Returns:    int - 1 if all three channels are inside their bounds, 0 if not
+Side Notes: uses & instead of && so there is no branch for each channel
+*/
+inline int pixelInRange(const Vec3b &pixel, const int *hsvPtr) {
+     return (pixel[0] >= hsvPtr[0]) & (pixel[0] <= hsvPtr[1])
+          & (pixel[1] >= hsvPtr[2]) & (pixel[1] <= hsvPtr[3])
+          & (pixel[2] >= hsvPtr[4]) & (pixel[2] <= hsvPtr[5]);
+}
+
+#if CV_SIMD
+//OpenCV 4.9 replaced the operators on its universal intrinsics with functions
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 9)
+inline v_uint8 maskAnd(const v_uint8 &a, const v_uint8 &b) { return v_and(a, b); }
+inline v_uint8 maskBetween(const v_uint8 &x, const v_uint8 &low, const v_uint8 &high) { return v_and(v_ge(x, low), v_le(x, high)); }
+inline int vectorLanes() { return VTraits<v_uint8>::vlanes(); }
+#else
+inline v_uint8 maskAnd(const v_uint8 &a, const v_uint8 &b) { return a & b; }
+inline v_uint8 maskBetween(const v_uint8 &x, const v_uint8 &low, const v_uint8 &high) { return (x >= low) & (x <= high); }
+inline int vectorLanes() { return v_uint8::nlanes; }
+#endif
+
+//A calibrated HSV range with every bound copied into all the lanes of a vector
+struct VectorRange {
+     v_uint8 lowH, highH, lowS, highS, lowV, highV;
+
+     VectorRange(const int *hsvPtr)
+          : lowH(vx_setall_u8((uchar) hsvPtr[0])), highH(vx_setall_u8((uchar) hsvPtr[1])),
+            lowS(vx_setall_u8((uchar) hsvPtr[2])), highS(vx_setall_u8((uchar) hsvPtr[3])),
+            lowV(vx_setall_u8((uchar) hsvPtr[4])), highV(vx_setall_u8((uchar) hsvPtr[5])) {}
+};
+
+/*
+Function: vectorInRange
+Purpose: same as pixelInRange, for a whole vector of pixels at once
+Arguments:  v_uint8 - the hue, saturation and value of each pixel
+            VectorRange - the calibrated range
+Returns:    v_uint8 - 255 in the lanes of pixels inside the range, 0 in the others
+*/
+inline v_uint8 vectorInRange(const v_uint8 &h, const v_uint8 &s, const v_uint8 &v, const VectorRange &range) {
+     return maskAnd(maskAnd(maskBetween(h, range.lowH, range.highH), maskBetween(s, range.lowS, range.highS)),
+                    maskBetween(v, range.lowV, range.highV));
+}
+#endif
+
+/*
+Function: classifyFrame
+Purpose: label every pixel of a frame as empty, player or robot in a single pass
+         and reduce the labels to the state of each space on the board.
+Arguments:  Mat - the original BGR frame
+            int* - the player's HSV values
+            int* - the robot's HSV values
+            int[6][7] - filled in with 0 (empty), 1 (player) or 2 (robot) for each space
+Returns:    Mat - the labelled image, 0 for empty, 127 for player and 255 for robot
+Side Notes: row 0 is the bottom of the frame, same as the board array.
+            If a pixel is inside both ranges it is counted as the player's.
+            Uses OpenCV's universal intrinsics (SSE2, NEON, ...) when the build has them,
+            with pixelInRange for the pixels left over at the end of each column.
+*/
+Mat classifyFrame(Mat imgOriginal, int *playerHsv, int *robotHsv, int cellStates[6][7]) {
+     //Convert once, both colors are checked against the same HSV frame
+     Mat imgHSV;
+     cvtColor(imgOriginal, imgHSV, COLOR_BGR2HSV);
+
+     int width = imgHSV.cols;
+     int height = imgHSV.rows;
+     Mat labels(height, width, CV_8UC1);
+
+     //pixel counts for each space, [row][col][who]
+     int counts[6][7][3] = {};
+
+     //the first x coordinate of every column, so each column is a run of pixels
+     //and the inner loop doesn't have to look up which column a pixel is in
+     int colStart[8];
+     for (int j = 0; j < 8; j++)
+          colStart[j] = j * width / 7;
+
+#if CV_SIMD
+     const int lanes = vectorLanes();
+     const VectorRange playerRange(playerHsv);
+     const VectorRange robotRange(robotHsv);
+     const v_uint8 zero = vx_setzero_u8();
+     const v_uint8 playerLabel = vx_setall_u8(127);
+#endif
+
+     for (int y = 0; y < height; y++) {
+          const Vec3b *hsvRow = imgHSV.ptr<Vec3b>(y);
+          uchar *labelRow = labels.ptr<uchar>(y);
+          int row = (height - 1 - y) * 6 / height;
+
+          for (int j = 0; j < 7; j++) {
+               int player = 0;
+               int robot = 0;
+               int x = colStart[j];
+
+#if CV_SIMD
+               //the masks are 255 in every matching lane, so the sums are divided by 255 at the end
+               unsigned playerSum = 0;
+               unsigned robotSum = 0;
+
+               for (; x + lanes <= colStart[j + 1]; x += lanes) {
+                    v_uint8 h, s, v;
+                    v_load_deinterleave((const uchar *) (hsvRow + x), h, s, v);
+
+                    v_uint8 inPlayer = vectorInRange(h, s, v, playerRange);
+                    v_uint8 inRobot = v_select(inPlayer, zero, vectorInRange(h, s, v, robotRange));
+
+                    //the robot mask is already 255 where the robot's label goes
+                    v_store(labelRow + x, v_select(inPlayer, playerLabel, inRobot));
+
+                    playerSum += v_reduce_sum(inPlayer);
+                    robotSum += v_reduce_sum(inRobot);
+               }
+
+               player += playerSum / 255;
+               robot += robotSum / 255;
+#endif
+
+               for (; x < colStart[j + 1]; x++) {
+                    int inPlayer = pixelInRange(hsvRow[x], playerHsv);
+                    int inRobot = pixelInRange(hsvRow[x], robotHsv) & (inPlayer ^ 1);
+
+                    player += inPlayer;
+                    robot += inRobot;
+                    labelRow[x] = (uchar) (inPlayer * 127 + inRobot * 255);
+               }
+
+               counts[row][j][1] += player;
+               counts[row][j][2] += robot;
+               counts[row][j][0] += (colStart[j + 1] - colStart[j]) - player - robot;
+          }
+     }
+
+#if CV_SIMD
+     vx_cleanup();
+#endif
+
+     //a space belongs to whichever color covers more of it,
+     //as long as that color covers enough of the space to not just be noise
+     for (int i = 0; i < 6; i++) {
+          for (int j = 0; j < 7; j++) {
+               int total = counts[i][j][0] + counts[i][j][1] + counts[i][j][2];
+               int player = counts[i][j][1];
+               int robot = counts[i][j][2];
+
+               cellStates[i][j] = 0;
+               if (total == 0)
+                    continue;
+
+               if (player >= robot && player > minCellCoverage * total)
+                    cellStates[i][j] = 1;
+               else if (robot > player && robot > minCellCoverage * total)
+                    cellStates[i][j] = 2;
+          }
+     }
+
+     return labels;
+}
+
 /*
 Function: findMoments
 Purpose: subtract a new move from the previous one and find the center of the new mark.
 Arguments:   Mat - the previous game state
              Mat - the new game state
 Returns: Moments - the center of the new move
+Side Notes:  Deprecated, replaced by classifyFrame and Board::compareToObserved
 */
 Moments findMoments(Mat previousGameState, Mat newGameState) {
      //Make a new Mat image and subtract the previous game state from the new one
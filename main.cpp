@@ -1,6 +1,13 @@
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <random>
+#include <sstream>
+#include <string>
+#include <thread>
 #include "imageProcessing.h"
+#include "pipeline.h"
+#include "solver.h"
 
 using namespace std;
 
@@ -35,8 +42,14 @@ class Board {
 public:
     Space board[6][7];
 
+    //where messages about the board are printed,
+    //the pipeline points this at a buffer so only the display thread prints
+    ostream *out;
+
     //Constructor, initialize each space
     Board() {
+        out = &cout;
+
         for (int i = 0; i < 6; i++) {
             for (int j = 0; j < 7; j++) {
                 board[i][j] = Space(i, j);
@@ -54,7 +67,7 @@ public:
     */
     bool isSpaceOccupied(int row, int col) {
         if (row < 0 || row > 5 || col < 0 || col > 6) {
-            cout << "Invalid space" << endl;
+            *out << "Invalid space" << endl;
             return false;
         } else if (board[row][col].whoOccupies != 0)
             return true;
@@ -76,7 +89,7 @@ public:
         } else if (row == 0 || isSpaceOccupied((row - 1), col) && !isSpaceOccupied(row, col))
             return true;
         
-        cout << "Error" << endl;
+        *out << "Error" << endl;
         return false;
     }
 
@@ -90,7 +103,7 @@ public:
     */
     void playerOccupies(int row, int col) {
         if (row < 0 || row > 5 || col < 0 || col > 6) {
-            cout << "Invalid space" << endl;
+            *out << "Invalid space" << endl;
         } else if (board[row][col].whoOccupies == 0) {
             board[row][col].whoOccupies = 1;
         }
@@ -106,10 +119,10 @@ public:
     */
     void cpuOccupies (int row, int col) {
         if (row < 0 || row > 5 || col < 0 || col > 6) {
-            cout << "Invalid space" << endl;
+            *out << "Invalid space" << endl;
         } else if (board[row][col].whoOccupies == 0) {
             board[row][col].whoOccupies = 2;
-            cout << "Robot marks row " << row << " col " << col << endl;
+            *out << "Robot marks row " << row << " col " << col << endl;
         }
 
         //mark the board
@@ -404,6 +417,42 @@ public:
             return false;
     }
 
+    /*
+    Function: compareToObserved
+    Purpose: compare the board state seen by the camera against the board array
+                to find the player's new move and any spaces that don't match
+    Arguments:  int[6][7] - the observed state of each space, see classifyFrame
+                int& - set to the row of the player's new move, -1 if none is found
+                int& - set to the col of the player's new move, -1 if none is found
+    Returns:    int - the number of spaces that don't match, not counting the new move
+    */
+    int compareToObserved(int observed[6][7], int &newRow, int &newCol) {
+        int desyncs = 0;
+        newRow = -1;
+        newCol = -1;
+
+        for (int i = 0; i < 6; i++) {
+            for (int j = 0; j < 7; j++) {
+                int expected = board[i][j].whoOccupies;
+                if (observed[i][j] == expected)
+                    continue;
+
+                //the first new player mark on an empty space is the player's move,
+                //anything else means the camera and the board array disagree
+                if (expected == 0 && observed[i][j] == 1 && newRow == -1) {
+                    newRow = i;
+                    newCol = j;
+                } else {
+                    *out << "Desync at row " << i << " col " << j
+                         << ": expected " << expected << ", saw " << observed[i][j] << endl;
+                    desyncs++;
+                }
+            }
+        }
+
+        return desyncs;
+    }
+
     /*
     Function: isTieState
     Purpose: determine if all spots in board are occupied
@@ -422,76 +471,453 @@ public:
     }
 };
 
-//Main function
-int main() {
+//A frame after the vision stage has classified it
+struct VisionFrame {
+    Mat original;
+    Mat labels;
+};
+
+//The state of every space at the moment the player said their move was ready
+struct BoardObservation {
+    int cells[6][7];
+};
+
+//Everything the stages share. Each queue has exactly one stage pushing and one stage popping.
+struct GamePipeline {
+    BoundedQueue<Mat, 4> captured;                  //capture -> vision
+    BoundedQueue<VisionFrame, 4> classified;        //vision -> display
+    BoundedQueue<BoardObservation, 1> observations; //vision -> logic
+    BoundedQueue<string, 16> messages;              //logic -> display
+    BoundedQueue<string, 16> captureMessages;       //capture -> display
+    BoundedQueue<string, 16> visionMessages;        //vision -> display
+
+    StageStats captureStats;
+    StageStats visionStats;
+    StageStats logicStats;
+    StageStats displayStats;
+
+    atomic<bool> running;
+    atomic<bool> moveRequested; //set by the display when ESC is pressed
+    atomic<bool> logicBusy;     //set by vision when it hands over a move, cleared by logic when it wants the next one
+
+    int *playerHsv;
+    int *robotHsv;
+
+    GamePipeline(int *player, int *robot) : running(true), moveRequested(false), logicBusy(false), playerHsv(player), robotHsv(robot) {}
+};
+
+/*
+Function: captureStage
+Purpose: read frames from the camera and pass them to the vision stage
+Arguments:  GamePipeline& - the shared pipeline
+Returns:    N/A
+Side Effects: stops the pipeline if the camera can't be read
+*/
+void captureStage(GamePipeline &pipeline) {
+    VideoCapture cap(1); //might have to edit what the cap is
+
+    if (!cap.isOpened()) {
+        pushWait(pipeline.captureMessages, string("Cannot open the web cam"), pipeline.captureStats, pipeline.running);
+        pipeline.running = false;
+        return;
+    }
+
+    while (pipeline.running) {
+        Mat frame;
+
+        if (!cap.read(frame)) {
+            pushWait(pipeline.captureMessages, string("Cannot read a frame from video stream"),
+                     pipeline.captureStats, pipeline.running);
+            pipeline.running = false;
+            return;
+        }
+
+        pipeline.captureStats.processed++;
+        if (!pushWait(pipeline.captured, frame, pipeline.captureStats, pipeline.running))
+            return;
+    }
+}
+
+/*
+Function: visionStage
+Purpose: classify every frame, pass it on to be displayed,
+            and pass the board state to the game logic when the player's move is ready
+Arguments:  GamePipeline& - the shared pipeline
+Returns:    N/A
+*/
+void visionStage(GamePipeline &pipeline) {
+    Mat frame;
+
+    while (popWait(pipeline.captured, frame, pipeline.visionStats, pipeline.running)) {
+        VisionFrame classified;
+        BoardObservation observation;
+
+        classified.original = frame;
+        classified.labels = classifyFrame(frame, pipeline.playerHsv, pipeline.robotHsv, observation.cells);
+        pipeline.visionStats.processed++;
+
+        //only hand over a move when the game logic is waiting for one, a frame taken
+        //while it is busy would be from before the robot's mark was placed.
+        //The notice is dropped if the display is too far behind to take it.
+        if (pipeline.moveRequested.exchange(false)) {
+            if (pipeline.logicBusy.load() || !pipeline.observations.tryPush(observation)) {
+                pipeline.visionMessages.tryPush("Still working on the last move. Press ESC again in a moment.");
+            } else {
+                pipeline.logicBusy = true;
+            }
+        }
+
+        if (!pushWait(pipeline.classified, classified, pipeline.visionStats, pipeline.running))
+            return;
+    }
+}
+
+/*
+Function: postMessage
+Purpose: send a message from the game logic to be printed by the display stage
+Arguments:  GamePipeline& - the shared pipeline
+            string - the message
+Returns:    N/A
+*/
+void postMessage(GamePipeline &pipeline, string message) {
+    pushWait(pipeline.messages, message, pipeline.logicStats, pipeline.running);
+}
+
+/*
+Function: postBoardLog
+Purpose: send whatever the board printed to its buffer on to the display stage, one message per line
+Arguments:  GamePipeline& - the shared pipeline
+            ostringstream& - the board's buffer, emptied afterwards
+Returns:    N/A
+*/
+void postBoardLog(GamePipeline &pipeline, ostringstream &boardLog) {
+    istringstream lines(boardLog.str());
+    string line;
+
+    while (getline(lines, line))
+        postMessage(pipeline, line);
+
+    boardLog.str("");
+}
+
+/*
+Function: logicStage
+Purpose: play the game, taking the player's moves from the vision stage and deciding the robot's moves
+Arguments:  GamePipeline& - the shared pipeline
+Returns:    N/A
+Side Effects: stops the pipeline when the game is over
+*/
+void logicStage(GamePipeline &pipeline) {
     Board game = Board();
-    int turn = 0;
-    srand(time(0));
-    
-    //Calibrate HSV of player mark color and the size of frame
-    int *hsvPtr = calibratePlayerColor();
+    int turn = 1;
+    BoardObservation observation;
 
-    //end immediately if hsvPtr = -1
-    if (*hsvPtr == -1)
-        return 0;
-    
-    //wait for user to remove calibration mark and take a picture of the blank board
-    cout << "Please remove the calibration mark. Press ESC when calibration mark has been removed to take an image of the empty board." <<endl;
-    cout << "Press ESC to continue." << endl;
-    Mat previousGameState = getImage(hsvPtr);
+    //the board's messages go through the display stage like everything else
+    ostringstream boardLog;
+    game.out = &boardLog;
 
+    postMessage(pipeline, "Turn #1");
+    postMessage(pipeline, "Put your move on the board. Press ESC to continue.");
 
     //play the game for 21 turns
     //When turn reaches 22, all spaces should have been marked, so is a tie state
-    while (turn < 21) {
-        //increment turn
-        turn++;
-        cout << "Turn #" << turn << endl;
-        
-        //player move
-        //Get next game state
-        cout << "Put your move on the board. Press ESC to continue." << endl;
-        Mat newGameState = getImage(hsvPtr);
+    while (popWait(pipeline.observations, observation, pipeline.logicStats, pipeline.running)) {
+        pipeline.logicStats.processed++;
 
-        //Get coordinates of next move
-        Moments newMove = findMoments(previousGameState, newGameState);
+        //Find the new move and check the rest of the board still matches
+        int row, col;
+        int desyncs = game.compareToObserved(observation.cells, row, col);
+        postBoardLog(pipeline, boardLog);
 
-        //Calculate relative position of the move
-        int col = trunc(float (int (newMove.m10 / newMove.m00)) / *(hsvPtr + 6) * 7);
-        int row = trunc(float (*(hsvPtr + 7) - (int (newMove.m01 / newMove.m00))) / *(hsvPtr + 7) * 6);
+        if (desyncs > 0 || row == -1) {
+            pipeline.logicBusy = false;
+            postMessage(pipeline, "Error. The board doesn't match the game state. Please fix the board and try again.");
+            continue;
+        }
 
         //checking if space is available
         //if not, try again
-        if (game.isSpaceAvailable(row, col))
+        bool available = game.isSpaceAvailable(row, col);
+        if (available)
             game.playerOccupies(row, col);
-        else {
-            cout << "Error. Invalid option. Please try again." << endl;
-            turn--;
+        postBoardLog(pipeline, boardLog);
+
+        if (!available) {
+            pipeline.logicBusy = false;
+            postMessage(pipeline, "Error. Invalid option. Please try again.");
             continue;
         }
 
         //check for 4-in-a-row, only check on turn 4 or higher to reduce runtime
         if (turn > 3 && game.is4InARow(row, col, 1)) {
-            cout << "Congratulations, player! You won!" << endl;
+            postMessage(pipeline, "Congratulations, player! You won!");
             break;
         }
 
         //computer move
         //Call function to decide robot's next move
         Space robotMove = game.decideRobotMove(col);
+        postBoardLog(pipeline, boardLog);
 
         //check for 4-in-a-row, only check on turn 4 or higher to reduce runtime
         if (turn > 3 && game.is4InARow(robotMove.rowCoordinate, robotMove.colCoordinate, 2)) {
-            cout << "Sorry, CPU player won! Better luck next time!" << endl;
+            postMessage(pipeline, "Sorry, CPU player won! Better luck next time!");
+            break;
+        }
+
+        if (turn >= 21) {
+            postMessage(pipeline, "Tie state reached. Ending game.");
             break;
         }
 
-        //set the previous game state to the current one
-        previousGameState = newGameState;
+        turn++;
+        pipeline.logicBusy = false;
+        postMessage(pipeline, "Turn #" + to_string(turn));
+        postMessage(pipeline, "Put your move on the board. Press ESC to continue.");
+    }
+
+    pipeline.running = false;
+}
+
+/*
+Function: printPipelineStats
+Purpose: print the stats of every stage, to see which one is holding up the others
+Arguments:  GamePipeline& - the shared pipeline
+Returns:    N/A
+*/
+void printPipelineStats(GamePipeline &pipeline) {
+    cout << "Pipeline stats:" << endl;
+    printStageStats("capture", pipeline.captureStats, 0);
+    printStageStats("vision", pipeline.visionStats, pipeline.captured.depth());
+    printStageStats("logic", pipeline.logicStats, pipeline.observations.depth());
+    printStageStats("display", pipeline.displayStats, pipeline.classified.depth());
+}
+
+/*
+Function: printMessages
+Purpose: print every message the other stages have sent to the display
+Arguments:  GamePipeline& - the shared pipeline
+Returns:    N/A
+*/
+void printMessages(GamePipeline &pipeline) {
+    string message;
+
+    while (pipeline.captureMessages.tryPop(message))
+        cout << message << endl;
+
+    while (pipeline.visionMessages.tryPop(message))
+        cout << message << endl;
+
+    while (pipeline.messages.tryPop(message))
+        cout << message << endl;
+}
+
+/*
+Function: displayStage
+Purpose: show the newest classified frame, print messages from the other stages and handle key presses
+Arguments:  GamePipeline& - the shared pipeline
+Returns:    N/A
+Side Notes: runs on the main thread, since that is where the windows have to be drawn
+*/
+void displayStage(GamePipeline &pipeline) {
+    VisionFrame frame;
+
+    cout << "Press ESC when your move is on the board, S to show pipeline stats or Q to quit." << endl;
+
+    while (pipeline.running) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        //skip to the newest frame so the window never falls behind the camera
+        bool gotFrame = false;
+        while (pipeline.classified.tryPop(frame))
+            gotFrame = true;
+
+        if (gotFrame) {
+            imshow("OG", frame.original);
+            imshow("classified", frame.labels);
+            pipeline.displayStats.processed++;
+        }
+
+        printMessages(pipeline);
+
+        int key = waitKey(10);
+        if (key == 27)
+            pipeline.moveRequested = true;
+        else if (key == 's' || key == 'S')
+            printPipelineStats(pipeline);
+        else if (key == 'q' || key == 'Q')
+            pipeline.running = false;
+
+        if (!gotFrame)
+            pipeline.displayStats.waitInMicros += microsSince(start);
+    }
+
+    //print whatever the other stages said last
+    printMessages(pipeline);
+
+    destroyAllWindows();
+}
+
+/*
+Function: parseNumberArg
+Purpose: read a whole number command line value and check its range
+Arguments:  const char* - the text of the value
+            int - the smallest allowed value
+            int - the largest allowed value
+            int& - set to the value
+Returns:    bool - false if the text isn't a whole number or is out of range
+*/
+bool parseNumberArg(const char *text, int low, int high, int &value) {
+    char *end;
+    long parsed = strtol(text, &end, 10);
+
+    if (end == text || *end != '\0' || parsed < low || parsed > high)
+        return false;
+
+    value = (int) parsed;
+    return true;
+}
+
+/*
+Function: printAnalysisUsage
+Purpose: print how to run the analysis mode
+Arguments:  N/A
+Returns:    int - 1, the exit code for a usage error
+*/
+int printAnalysisUsage() {
+    cerr << "Usage: projectCode --analyze [--depth N] [--threads N] [file]" << endl;
+    cerr << "  --depth N    moves to search, 2 to 42 (default 14)" << endl;
+    cerr << "  --threads N  threads to use, 1 to 256 (default one per core)" << endl;
+    cerr << "  file         file of move strings, one per word, or - to read stdin (default stdin)" << endl;
+    cerr << "               inside the input, a move string of - is the empty board" << endl;
+    return 1;
+}
+
+/*
+Function: runAnalysis
+Purpose: analyze positions without the camera, reading move strings from a file or stdin
+            and printing the moves, best column (1 to 7, 0 if the game is already over), score and
+            nodes searched for each one, in the same order
+Arguments:  int - argc
+            char** - argv, --analyze [--depth N] [--threads N] [file], a file of - reads stdin
+Returns:    int - 0 if the positions were analyzed, 1 for a usage error or if the file couldn't be opened
+Side Notes: see solver.h for what the scores mean. Positions that can't be played print "invalid".
+*/
+int runAnalysis(int argc, char *argv[]) {
+    int depth = 14;
+    int threadCount = (int) thread::hardware_concurrency();
+    string fileName;
+    bool inputGiven = false;
+
+    for (int i = 2; i < argc; i++) {
+        string arg = argv[i];
+
+        if (arg == "--depth") {
+            if (i + 1 >= argc || !parseNumberArg(argv[++i], 2, 42, depth)) {
+                cerr << "--depth needs a number from 2 to 42" << endl;
+                return printAnalysisUsage();
+            }
+        } else if (arg == "--threads") {
+            if (i + 1 >= argc || !parseNumberArg(argv[++i], 1, 256, threadCount)) {
+                cerr << "--threads needs a number from 1 to 256" << endl;
+                return printAnalysisUsage();
+            }
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            cerr << "Unknown option " << arg << endl;
+            return printAnalysisUsage();
+        } else if (inputGiven) {
+            cerr << "Only one input file can be given" << endl;
+            return printAnalysisUsage();
+        } else {
+            //a bare - means stdin, same as leaving the file out
+            inputGiven = true;
+            if (arg != "-")
+                fileName = arg;
+        }
+    }
+
+    //hardware_concurrency can't always tell how many cores there are
+    if (threadCount < 1)
+        threadCount = 1;
+
+    ifstream file;
+    if (!fileName.empty()) {
+        file.open(fileName.c_str());
+
+        if (!file) {
+            cerr << "Cannot open " << fileName << endl;
+            return 1;
+        }
+    }
+
+    istream &input = fileName.empty() ? cin : file;
+
+    //one position per word, so blank lines and windows line endings don't matter
+    vector<string> positions;
+    string moves;
+    while (input >> moves)
+        positions.push_back(moves);
+
+    //4 million slots, 64MB, shared by every thread
+    PositionCache cache(22);
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<AnalysisResult> results = analyzePositions(positions, depth, threadCount, cache);
+    double seconds = microsSince(start) / 1e6;
+
+    for (size_t i = 0; i < results.size(); i++) {
+        if (!results[i].valid)
+            cout << positions[i] << " invalid" << endl;
+        else
+            cout << positions[i] << " " << results[i].bestCol + 1 << " " << results[i].score
+                 << " " << results[i].nodes << endl;
     }
+
+    cerr << "Analyzed " << positions.size() << " positions in " << seconds << " s ("
+         << (seconds > 0 ? positions.size() / seconds : 0) << " positions/sec, "
+         << threadCount << " threads, depth " << depth << ")" << endl;
+
+    return 0;
+}
+
+//Main function
+int main(int argc, char *argv[]) {
+    //analysis mode doesn't use the camera at all
+    if (argc > 1 && string(argv[1]) == "--analyze")
+        return runAnalysis(argc, argv);
+
+    srand(time(0));
     
-    if (turn >= 21)
-        cout << "Tie state reached. Ending game.";
+    //Calibrate HSV of player and robot mark colors and the size of frame
+    int *hsvPtr = calibratePlayerColor();
+
+    //end immediately if hsvPtr = -1
+    if (*hsvPtr == -1)
+        return 0;
+
+    int *robotHsvPtr = calibrateRobotColor();
+
+    if (*robotHsvPtr == -1)
+        return 0;
+
+    //wait for user to remove calibration marks before the game starts
+    cout << "Please remove the calibration marks before making your first move." << endl;
+
+    //capture, vision and game logic each get their own thread,
+    //the display stays on the main thread
+    GamePipeline pipeline(hsvPtr, robotHsvPtr);
+
+    thread captureThread(captureStage, ref(pipeline));
+    thread visionThread(visionStage, ref(pipeline));
+    thread logicThread(logicStage, ref(pipeline));
+
+    displayStage(pipeline);
+
+    captureThread.join();
+    visionThread.join();
+    logicThread.join();
+
+    printPipelineStats(pipeline);
 
     return 0;
     
@@ -0,0 +1,169 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+//Pieces for running the game as separate stages on their own threads.
+//Each pair of stages is connected by a BoundedQueue with exactly one thread pushing
+//and one thread popping, so the queue only needs a pair of atomic indexes and no locks.
+
+/*
+Class: BoundedQueue
+Purpose: fixed size single producer, single consumer queue
+Side Notes: one slot is always left empty so a full queue can be told apart from an empty one
+*/
+template <class T, size_t Capacity>
+class BoundedQueue {
+public:
+    BoundedQueue() : head(0), tail(0) {}
+
+    /*
+    Function: tryPush
+    Purpose: add an item to the back of the queue, only called by the producer
+    Arguments:  T - the item
+    Returns:    bool - true if the item was added, false if the queue is full
+    */
+    bool tryPush(const T &item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t next = (t + 1) % (Capacity + 1);
+
+        if (next == head.load(std::memory_order_acquire))
+            return false;
+
+        slots[t] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    /*
+    Function: tryPop
+    Purpose: take the item at the front of the queue, only called by the consumer
+    Arguments:  T& - set to the item
+    Returns:    bool - true if an item was taken, false if the queue is empty
+    */
+    bool tryPop(T &item) {
+        size_t h = head.load(std::memory_order_relaxed);
+
+        if (h == tail.load(std::memory_order_acquire))
+            return false;
+
+        item = slots[h];
+        slots[h] = T(); //don't keep frames alive after they've been taken
+        head.store((h + 1) % (Capacity + 1), std::memory_order_release);
+        return true;
+    }
+
+    /*
+    Function: depth
+    Purpose: get the number of items waiting in the queue
+    Arguments:  N/A
+    Returns:    size_t - the number of items, may be stale by the time it is used
+    */
+    size_t depth() const {
+        size_t h = head.load(std::memory_order_acquire);
+        size_t t = tail.load(std::memory_order_acquire);
+        return (t + Capacity + 1 - h) % (Capacity + 1);
+    }
+
+private:
+    T slots[Capacity + 1];
+
+    //kept on separate cache lines so the two threads don't fight over them
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+};
+
+//Counters for one stage, written by that stage and read by whoever prints them.
+//waitIn is time spent with nothing to work on, waitOut is time spent with the next stage's queue full.
+struct StageStats {
+    std::atomic<uint64_t> processed;
+    std::atomic<uint64_t> waitInMicros;
+    std::atomic<uint64_t> waitOutMicros;
+
+    StageStats() : processed(0), waitInMicros(0), waitOutMicros(0) {}
+};
+
+/*
+Function: microsSince
+Purpose: get the time passed since a starting point
+Arguments:  time_point - the starting point
+Returns:    uint64_t - the microseconds since start
+*/
+inline uint64_t microsSince(std::chrono::steady_clock::time_point start) {
+    return (uint64_t) std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+Function: pushWait
+Purpose: push an item, waiting while the queue is full
+Arguments:  BoundedQueue& - the queue
+            T - the item
+            StageStats& - the pushing stage's stats, the wait is added to waitOut
+            atomic<bool>& - cleared when the pipeline is shutting down
+Returns:    bool - true if the item was pushed, false if the pipeline shut down first
+*/
+template <class T, size_t Capacity>
+bool pushWait(BoundedQueue<T, Capacity> &queue, const T &item, StageStats &stats, const std::atomic<bool> &running) {
+    if (queue.tryPush(item))
+        return true;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool pushed = false;
+
+    while (running.load() && !pushed) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        pushed = queue.tryPush(item);
+    }
+
+    stats.waitOutMicros += microsSince(start);
+    return pushed;
+}
+
+/*
+Function: popWait
+Purpose: pop an item, waiting while the queue is empty
+Arguments:  BoundedQueue& - the queue
+            T& - set to the item
+            StageStats& - the popping stage's stats, the wait is added to waitIn
+            atomic<bool>& - cleared when the pipeline is shutting down
+Returns:    bool - true if an item was popped, false if the pipeline shut down first
+*/
+template <class T, size_t Capacity>
+bool popWait(BoundedQueue<T, Capacity> &queue, T &item, StageStats &stats, const std::atomic<bool> &running) {
+    if (queue.tryPop(item))
+        return true;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool popped = false;
+
+    while (running.load() && !popped) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        popped = queue.tryPop(item);
+    }
+
+    stats.waitInMicros += microsSince(start);
+    return popped;
+}
+
+/*
+Function: printStageStats
+Purpose: print one line of stats for a stage
+Arguments:  const char* - the name of the stage
+            StageStats& - the stage's stats
+            size_t - the depth of the stage's input queue
+Returns:    N/A
+*/
+inline void printStageStats(const char *name, const StageStats &stats, size_t inputDepth) {
+    std::cout << "  " << name
+              << ": processed " << stats.processed.load()
+              << ", input queue " << inputDepth
+              << ", waiting for input " << stats.waitInMicros.load() / 1000 << " ms"
+              << ", waiting on output " << stats.waitOutMicros.load() / 1000 << " ms" << std::endl;
+}
+
+#endif
@@ -0,0 +1,467 @@
+#ifndef SOLVER_H
+#define SOLVER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include "evaluation.h"
+
+//Alpha-beta search over the packed boards from evaluation.h, used to analyze positions offline.
+//
+//Scores are from the point of view of the player whose turn it is:
+//   a forced win scores winScore minus the number of moves on the board when the game is won,
+//   so faster wins score higher, and a forced loss is the negative of that.
+//   Anything closer to 0 than winScore - 42 is a guess from the threat counts at the end of the search.
+//   A draw is 0.
+
+const int winScore = 1000;
+const int infiniteScore = 10000;
+
+//Columns to try first, the middle columns are in more lines so are usually better
+const int columnOrder[7] = {3, 2, 4, 1, 5, 0, 6};
+
+//A position to search. current is the spaces of the player whose turn it is, mask is every marked space.
+struct SolverPosition {
+    uint64_t current;
+    uint64_t mask;
+    int moves;
+
+    SolverPosition() : current(0), mask(0), moves(0) {}
+
+    /*
+    Function: canPlay
+    Purpose: determine if a column has room for another mark
+    Arguments:  int - the column
+    Returns:    bool - true if the top space of the column is empty
+    */
+    bool canPlay(int col) const {
+        return (mask & cellBit(5, col)) == 0;
+    }
+
+    /*
+    Function: moveBit
+    Purpose: get the space a mark in a column would land on
+    Arguments:  int - the column
+    Returns:    uint64_t - the mask with only that space set
+    */
+    uint64_t moveBit(int col) const {
+        return (mask + cellBit(0, col)) & (0x3FULL << (col * 7));
+    }
+
+    /*
+    Function: play
+    Purpose: mark a column for the player whose turn it is, then switch players
+    Arguments:  int - the column, has to be playable
+    Returns:    N/A
+    */
+    void play(int col) {
+        current ^= mask;
+        mask |= mask + cellBit(0, col);
+        moves++;
+    }
+
+    /*
+    Function: key
+    Purpose: get a number that is different for every position, for the position cache
+    Arguments:  N/A
+    Returns:    uint64_t - the key, fits in 49 bits
+    */
+    uint64_t key() const {
+        return current + mask;
+    }
+};
+
+/*
+Function: hasFourInARow
+Purpose: determine if a set of spaces contains 4 in a row in any direction
+Arguments:  uint64_t - the spaces
+Returns:    bool - true if 4 in a row is found
+*/
+inline bool hasFourInARow(uint64_t spaces) {
+    //vertical, horizontal, and the two diagonals
+    const int directions[4] = {1, 7, 6, 8};
+
+    for (int i = 0; i < 4; i++) {
+        uint64_t pairs = spaces & (spaces >> directions[i]);
+        if (pairs & (pairs >> (2 * directions[i])))
+            return true;
+    }
+
+    return false;
+}
+
+/*
+Function: isWinningMove
+Purpose: determine if marking a column wins the game for the player whose turn it is
+Arguments:  SolverPosition - the position
+            int - the column, has to be playable
+Returns:    bool - true if the move makes 4 in a row
+*/
+inline bool isWinningMove(const SolverPosition &pos, int col) {
+    return hasFourInARow(pos.current | pos.moveBit(col));
+}
+
+/*
+Function: parseMoves
+Purpose: build a position from a string of moves
+Arguments:  string - the columns played in order, 1 to 7, starting with the first player,
+                     or "-" for the empty board
+            SolverPosition& - set to the position
+            bool& - set to true if the last move won the game
+Returns:    bool - false if the string has anything other than columns, plays a full column,
+                   or keeps going after someone has already won
+*/
+inline bool parseMoves(const std::string &moves, SolverPosition &pos, bool &gameOver) {
+    pos = SolverPosition();
+    gameOver = false;
+
+    if (moves == "-")
+        return true;
+
+    for (size_t i = 0; i < moves.size(); i++) {
+        int col = moves[i] - '1';
+
+        if (gameOver || col < 0 || col > 6 || !pos.canPlay(col))
+            return false;
+
+        gameOver = isWinningMove(pos, col);
+        pos.play(col);
+    }
+
+    return true;
+}
+
+/*
+Class: PositionCache
+Purpose: fixed size cache of search results shared by every search thread
+Side Notes: each slot is two atomics holding the data and the data xor'd with the key,
+            so a slot torn by two threads writing at once fails the key check instead of
+            returning the wrong result. Newer results always replace older ones.
+*/
+class PositionCache {
+public:
+    //how a cached score relates to the real score
+    enum Bound { exact = 0, lower = 1, upper = 2 };
+
+    PositionCache(int sizeLog2) : shift(64 - sizeLog2), size((size_t) 1 << sizeLog2), slots(new Slot[(size_t) 1 << sizeLog2]) {
+        for (size_t i = 0; i < size; i++) {
+            slots[i].check = 0;
+            slots[i].data = 0;
+        }
+    }
+
+    ~PositionCache() {
+        delete[] slots;
+    }
+
+    /*
+    Function: store
+    Purpose: save the result of searching a position
+    Arguments:  uint64_t - the position's key
+                int - the score
+                Bound - whether the score is exact, a lower bound or an upper bound
+                int - how many moves deep the search went, 0 to 63
+                int - the best column found, 0 to 6
+    Returns:    N/A
+    */
+    void store(uint64_t key, int score, Bound bound, int depth, int bestCol) {
+        uint64_t data = (uint64_t) (uint16_t) (int16_t) score
+                        | (uint64_t) bound << 16
+                        | (uint64_t) depth << 18
+                        | (uint64_t) bestCol << 24
+                        | (uint64_t) 1 << 27; //so an empty slot never looks valid
+
+        Slot &slot = slots[index(key)];
+        slot.check.store(key ^ data, std::memory_order_relaxed);
+        slot.data.store(data, std::memory_order_relaxed);
+    }
+
+    /*
+    Function: load
+    Purpose: look up the result of searching a position
+    Arguments:  uint64_t - the position's key
+                int& - set to the score
+                Bound& - set to the kind of score
+                int& - set to how many moves deep the search went
+                int& - set to the best column found
+    Returns:    bool - true if the position was found
+    */
+    bool load(uint64_t key, int &score, Bound &bound, int &depth, int &bestCol) const {
+        const Slot &slot = slots[index(key)];
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+        uint64_t check = slot.check.load(std::memory_order_relaxed);
+
+        if ((check ^ data) != key || !(data & ((uint64_t) 1 << 27)))
+            return false;
+
+        score = (int16_t) (uint16_t) (data & 0xFFFF);
+        bound = (Bound) ((data >> 16) & 0x3);
+        depth = (int) ((data >> 18) & 0x3F);
+        bestCol = (int) ((data >> 24) & 0x7);
+        return true;
+    }
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> check;
+        std::atomic<uint64_t> data;
+    };
+
+    int shift;
+    size_t size;
+    Slot *slots;
+
+    //keys of nearby positions only differ in a few bits, so mix them before picking a slot
+    size_t index(uint64_t key) const {
+        return (size_t) ((key * 0x9E3779B97F4A7C15ULL) >> shift);
+    }
+
+    //not copyable, the slots belong to this cache
+    PositionCache(const PositionCache &);
+    PositionCache &operator=(const PositionCache &);
+};
+
+/*
+Function: scoreThreats
+Purpose: guess how good a position is from the threat counts of both sides
+Arguments:  ThreatCounts - the counts for the side being scored
+            ThreatCounts - the counts for the other side
+Returns:    int - the guessed score, always well inside +/- winScore
+*/
+inline int scoreThreats(const ThreatCounts &mine, const ThreatCounts &theirs) {
+    return 4 * (mine.playableThreats - theirs.playableThreats)
+           + 2 * (mine.openThrees - theirs.openThrees)
+           + (mine.openTwos - theirs.openTwos);
+}
+
+/*
+Function: evaluateChildren
+Purpose: score every move from a position with one batch of static evaluations
+Arguments:  SolverPosition - the position, nobody can win on this move
+            uint64_t& - the running node count
+Returns:    int - the best score for the player whose turn it is
+*/
+inline int evaluateChildren(const SolverPosition &pos, uint64_t &nodes) {
+    //both sides of every child go in the same batch, the player's sides first
+    uint64_t mine[14], theirs[14];
+    ThreatCounts counts[14];
+    int children = 0;
+
+    for (int col = 0; col < 7; col++) {
+        if (!pos.canPlay(col))
+            continue;
+
+        mine[children] = pos.current | pos.moveBit(col);
+        theirs[children] = pos.mask ^ pos.current;
+        children++;
+    }
+
+    for (int i = 0; i < children; i++) {
+        mine[children + i] = theirs[i];
+        theirs[children + i] = mine[i];
+    }
+
+    evaluatePositions(mine, theirs, 2 * children, counts);
+    nodes += children;
+
+    int best = -infiniteScore;
+    for (int i = 0; i < children; i++) {
+        int score = scoreThreats(counts[i], counts[children + i]);
+        if (score > best)
+            best = score;
+    }
+
+    return best;
+}
+
+/*
+Function: negamax
+Purpose: search a position with alpha-beta pruning
+Arguments:  SolverPosition - the position, the previous move didn't win
+            int - how many more moves to search, at least 1
+            int - alpha, the score the player whose turn it is already has
+            int - beta, the score the other player already has
+            PositionCache& - the shared cache
+            uint64_t& - the running node count
+Returns:    int - the score, see the top of this file
+*/
+inline int negamax(const SolverPosition &pos, int depth, int alpha, int beta, PositionCache &cache, uint64_t &nodes) {
+    nodes++;
+
+    if (pos.moves == 42)
+        return 0;
+
+    //win right away if possible
+    for (int col = 0; col < 7; col++) {
+        if (pos.canPlay(col) && isWinningMove(pos, col))
+            return winScore - (pos.moves + 1);
+    }
+
+    //the last move can't be a win or we'd have returned, so a full board after it is a draw
+    if (pos.moves == 41)
+        return 0;
+
+    if (depth == 1)
+        return evaluateChildren(pos, nodes);
+
+    int originalAlpha = alpha;
+    int cachedScore, cachedDepth, cachedCol = -1;
+    PositionCache::Bound bound;
+    uint64_t key = pos.key();
+
+    if (cache.load(key, cachedScore, bound, cachedDepth, cachedCol) && cachedDepth >= depth) {
+        if (bound == PositionCache::exact)
+            return cachedScore;
+        else if (bound == PositionCache::lower && cachedScore > alpha)
+            alpha = cachedScore;
+        else if (bound == PositionCache::upper && cachedScore < beta)
+            beta = cachedScore;
+
+        if (alpha >= beta)
+            return cachedScore;
+    }
+
+    int best = -infiniteScore;
+    int bestCol = 0;
+
+    //try the cached best column first, then the usual order
+    for (int i = -1; i < 7; i++) {
+        int col = (i == -1) ? cachedCol : columnOrder[i];
+        if (col < 0 || col > 6 || (i >= 0 && col == cachedCol) || !pos.canPlay(col))
+            continue;
+
+        SolverPosition child = pos;
+        child.play(col);
+        int score = -negamax(child, depth - 1, -beta, -alpha, cache, nodes);
+
+        if (score > best) {
+            best = score;
+            bestCol = col;
+        }
+
+        if (best > alpha)
+            alpha = best;
+
+        if (alpha >= beta)
+            break;
+    }
+
+    if (best <= originalAlpha)
+        cache.store(key, best, PositionCache::upper, depth, bestCol);
+    else if (best >= beta)
+        cache.store(key, best, PositionCache::lower, depth, bestCol);
+    else
+        cache.store(key, best, PositionCache::exact, depth, bestCol);
+
+    return best;
+}
+
+//Result of analyzing one position
+struct AnalysisResult {
+    bool valid;
+    int bestCol;    //0 to 6, -1 if the game is already over
+    int score;
+    uint64_t nodes;
+
+    AnalysisResult() : valid(false), bestCol(-1), score(0), nodes(0) {}
+};
+
+/*
+Function: analyzePosition
+Purpose: find the best column and score for a position
+Arguments:  string - the moves played so far, see parseMoves
+            int - how many moves deep to search, at least 2, anything past the end of the game
+                  is cut down to the moves left, and the result is then exact
+            PositionCache& - the shared cache
+Returns:    AnalysisResult - the result, valid is false if the moves couldn't be parsed
+Side Notes: a game that is already over has no best column. If the last move won,
+            the score is the loss for the player whose turn it would be.
+*/
+inline AnalysisResult analyzePosition(const std::string &moves, int depth, PositionCache &cache) {
+    AnalysisResult result;
+    SolverPosition pos;
+    bool gameOver;
+
+    if (!parseMoves(moves, pos, gameOver))
+        return result;
+
+    //the cache only has room for depths up to 63, and searching past the end of the game does nothing
+    if (depth < 2)
+        depth = 2;
+    if (depth > 42 - pos.moves)
+        depth = 42 - pos.moves;
+
+    result.valid = true;
+    result.nodes = 1;
+
+    if (gameOver) {
+        result.score = -(winScore - pos.moves);
+        return result;
+    }
+
+    if (pos.moves == 42)
+        return result;
+
+    //take a win right away if there is one
+    for (int i = 0; i < 7; i++) {
+        int col = columnOrder[i];
+        if (pos.canPlay(col) && isWinningMove(pos, col)) {
+            result.bestCol = col;
+            result.score = winScore - (pos.moves + 1);
+            return result;
+        }
+    }
+
+    int alpha = -infiniteScore;
+    for (int i = 0; i < 7; i++) {
+        int col = columnOrder[i];
+        if (!pos.canPlay(col))
+            continue;
+
+        SolverPosition child = pos;
+        child.play(col);
+        int score = -negamax(child, depth - 1, -infiniteScore, -alpha, cache, result.nodes);
+
+        if (result.bestCol == -1 || score > alpha) {
+            alpha = score;
+            result.bestCol = col;
+            result.score = score;
+        }
+    }
+
+    return result;
+}
+
+/*
+Function: analyzePositions
+Purpose: analyze a list of positions, spread across threads that share one cache
+Arguments:  vector<string> - the positions, see parseMoves
+            int - how many moves deep to search, see analyzePosition
+            int - how many threads to use
+            PositionCache& - the shared cache
+Returns:    vector<AnalysisResult> - the results, in the same order as the positions
+*/
+inline std::vector<AnalysisResult> analyzePositions(const std::vector<std::string> &positions, int depth,
+                                                    int threadCount, PositionCache &cache) {
+    std::vector<AnalysisResult> results(positions.size());
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+
+    //each thread takes the next position that nobody has started yet
+    for (int t = 0; t < threadCount; t++) {
+        threads.push_back(std::thread([&]() {
+            size_t i;
+            while ((i = next++) < positions.size())
+                results[i] = analyzePosition(positions[i], depth, cache);
+        }));
+    }
+
+    for (size_t t = 0; t < threads.size(); t++)
+        threads[t].join();
+
+    return results;
+}
+
+#endif
@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <random>
+#include <vector>
+#include "evaluation.h"
+
+//Checks every evaluatePositions kernel this build has against a brute force count of the windows.
+//Built twice by CMake, once with the default flags (scalar and SSE2) and once with AVX2.
+
+//Return code that tells CTest the test was skipped
+const int skipTest = 77;
+
+int grid[6][7];
+
+/*
+Function: bruteForceCount
+Purpose: count the windows of one player by walking every 4 space line of the grid
+Arguments:  int - the player being scored, 1 or 2
+Returns:    ThreatCounts - the counts
+*/
+ThreatCounts bruteForceCount(int who) {
+    ThreatCounts counts = {0, 0, 0};
+    const int rowStep[4] = {1, 0, 1, -1};
+    const int colStep[4] = {0, 1, 1, 1};
+
+    for (int d = 0; d < 4; d++) {
+        for (int row = 0; row < 6; row++) {
+            for (int col = 0; col < 7; col++) {
+                int endRow = row + 3 * rowStep[d];
+                int endCol = col + 3 * colStep[d];
+                if (endRow < 0 || endRow > 5 || endCol > 6)
+                    continue;
+
+                int mine = 0, empty = 0, playable = 0;
+                for (int k = 0; k < 4; k++) {
+                    int r = row + k * rowStep[d];
+                    int c = col + k * colStep[d];
+
+                    if (grid[r][c] == who) {
+                        mine++;
+                    } else if (grid[r][c] == 0) {
+                        empty++;
+                        if (r == 0 || grid[r - 1][c] != 0)
+                            playable++;
+                    }
+                }
+
+                if (mine == 3 && empty == 1) {
+                    counts.openThrees++;
+                    counts.playableThreats += playable;
+                }
+                if (mine == 2 && empty == 2)
+                    counts.openTwos++;
+            }
+        }
+    }
+
+    return counts;
+}
+
+/*
+Function: sameCounts
+Purpose: compare two sets of counts
+Arguments:  ThreatCounts - the first counts
+            ThreatCounts - the second counts
+Returns:    bool - true if every count matches
+*/
+bool sameCounts(const ThreatCounts &a, const ThreatCounts &b) {
+    return a.openThrees == b.openThrees && a.openTwos == b.openTwos && a.playableThreats == b.playableThreats;
+}
+
+/*
+Function: checkLanes
+Purpose: run one kernel over all the positions and compare it to the expected counts
+Arguments:  const char* - the name of the kernel, for the output
+            uint64_t* - the scored side of every position
+            uint64_t* - the other side of every position
+            vector<ThreatCounts> - the expected counts
+Returns:    int - the number of positions that didn't match
+*/
+template <class L>
+int checkLanes(const char *name, const std::vector<uint64_t> &mine, const std::vector<uint64_t> &theirs,
+               const std::vector<ThreatCounts> &expected) {
+    std::vector<ThreatCounts> got(expected.size());
+    int count = (int) expected.size() / L::width * L::width;
+
+    for (int i = 0; i < count; i += L::width)
+        evaluateBlock<L>(&mine[i], &theirs[i], &got[i]);
+
+    int mismatches = 0;
+    for (int i = 0; i < count; i++) {
+        if (!sameCounts(got[i], expected[i]))
+            mismatches++;
+    }
+
+    printf("%s: %d positions, %d mismatches\n", name, count, mismatches);
+    return mismatches;
+}
+
+int main() {
+#if defined(__AVX2__) && (defined(__GNUC__) || defined(__clang__))
+    if (!__builtin_cpu_supports("avx2")) {
+        printf("AVX2 isn't supported on this CPU, skipping\n");
+        return skipTest;
+    }
+#endif
+
+    const int positions = 10007; //not a multiple of any vector width, so the leftovers get used
+    std::mt19937 rng(2319);
+    std::vector<uint64_t> mine(positions), theirs(positions);
+    std::vector<ThreatCounts> expected(positions);
+
+    //random games of random length, the player who moves first is the one being scored
+    for (int n = 0; n < positions; n++) {
+        for (int r = 0; r < 6; r++)
+            for (int c = 0; c < 7; c++)
+                grid[r][c] = 0;
+
+        int moves = rng() % 43;
+        int who = 1;
+        for (int m = 0; m < moves; m++) {
+            int col = rng() % 7;
+            int row = 0;
+            while (row < 6 && grid[row][col] != 0)
+                row++;
+            if (row == 6)
+                continue;
+
+            grid[row][col] = who;
+            who = 3 - who;
+        }
+
+        mine[n] = 0;
+        theirs[n] = 0;
+        for (int r = 0; r < 6; r++) {
+            for (int c = 0; c < 7; c++) {
+                if (grid[r][c] == 1)
+                    mine[n] |= cellBit(r, c);
+                else if (grid[r][c] == 2)
+                    theirs[n] |= cellBit(r, c);
+            }
+        }
+
+        expected[n] = bruteForceCount(1);
+    }
+
+    int mismatches = checkLanes<ScalarLanes>("scalar", mine, theirs, expected);
+
+#if defined(__SSE2__) || defined(_M_X64)
+    mismatches += checkLanes<SseLanes>("SSE2", mine, theirs, expected);
+#endif
+
+#if defined(__AVX2__)
+    mismatches += checkLanes<Avx2Lanes>("AVX2", mine, theirs, expected);
+#endif
+
+    //and the batch entry point, which mixes the widest kernel with the narrower ones for the leftovers
+    std::vector<ThreatCounts> got(positions);
+    evaluatePositions(&mine[0], &theirs[0], positions, &got[0]);
+
+    int batchMismatches = 0;
+    for (int i = 0; i < positions; i++) {
+        if (!sameCounts(got[i], expected[i]))
+            batchMismatches++;
+    }
+    printf("evaluatePositions: %d positions, %d mismatches\n", positions, batchMismatches);
+
+    return (mismatches + batchMismatches) == 0 ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+#include <stdio.h>
+#include <random>
+#include <string>
+#include <vector>
+#include "solver.h"
+
+//Checks the analysis solver against a brute force minimax on random late game positions,
+//plus a few positions with known answers.
+
+/*
+Function: bruteForce
+Purpose: score a position by trying every move to the end of the game, with no pruning or cache
+Arguments:  SolverPosition - the position, the previous move didn't win
+Returns:    int - the exact score, see solver.h
+*/
+int bruteForce(const SolverPosition &pos) {
+    if (pos.moves == 42)
+        return 0;
+
+    for (int col = 0; col < 7; col++) {
+        if (pos.canPlay(col) && isWinningMove(pos, col))
+            return winScore - (pos.moves + 1);
+    }
+
+    int best = -infiniteScore;
+    for (int col = 0; col < 7; col++) {
+        if (!pos.canPlay(col))
+            continue;
+
+        SolverPosition child = pos;
+        child.play(col);
+        int score = -bruteForce(child);
+        if (score > best)
+            best = score;
+    }
+
+    return best;
+}
+
+/*
+Function: checkKnown
+Purpose: analyze one position and compare it to a known answer
+Arguments:  string - the moves
+            int - the search depth
+            bool - whether the moves should parse
+            int - the expected best column, 0 to 6, -1 if the game is over
+            int - the expected score
+            PositionCache& - the cache
+Returns:    int - 1 if the result was wrong, 0 if it was right
+*/
+int checkKnown(const std::string &moves, int depth, bool valid, int bestCol, int score, PositionCache &cache) {
+    AnalysisResult result = analyzePosition(moves, depth, cache);
+
+    if (result.valid != valid || (valid && (result.bestCol != bestCol || result.score != score))) {
+        printf("%s: got valid %d col %d score %d, expected valid %d col %d score %d\n", moves.c_str(),
+               result.valid, result.bestCol, result.score, valid, bestCol, score);
+        return 1;
+    }
+
+    return 0;
+}
+
+int main() {
+    PositionCache cache(20);
+    int failures = 0;
+
+    //open three on the bottom row, the win comes on move 7
+    failures += checkKnown("4455", 10, true, 2, 993, cache);
+    //the last move already won, so there is nothing to play
+    failures += checkKnown("1212121", 10, true, -1, -993, cache);
+    //a move after the win, and a column that doesn't exist
+    failures += checkKnown("12121212", 10, false, -1, 0, cache);
+    failures += checkKnown("448", 10, false, -1, 0, cache);
+    //a depth far past the end of the game has to be cut down to fit in the cache
+    failures += checkKnown("34327653423425743564126112674676", 100, true, 2, -958, cache);
+
+    //the empty board has to parse
+    if (!analyzePosition("-", 4, cache).valid) {
+        printf("-: the empty board didn't parse\n");
+        failures++;
+    }
+
+    //random late game positions, short enough for the brute force to finish
+    std::mt19937 rng(2319);
+    std::vector<std::string> moves;
+    std::vector<SolverPosition> positions;
+
+    while (positions.size() < 300) {
+        SolverPosition pos;
+        std::string played;
+        int target = 30 + rng() % 8;
+
+        for (int tries = 0; tries < 500 && pos.moves < target; tries++) {
+            int col = rng() % 7;
+            if (!pos.canPlay(col) || isWinningMove(pos, col))
+                continue;
+
+            pos.play(col);
+            played += (char) ('1' + col);
+        }
+
+        if (pos.moves == target) {
+            moves.push_back(played);
+            positions.push_back(pos);
+        }
+    }
+
+    //several threads sharing the cache, the same way the analysis mode runs
+    std::vector<AnalysisResult> results = analyzePositions(moves, 42, 4, cache);
+
+    int mismatches = 0;
+    for (size_t i = 0; i < positions.size(); i++) {
+        int expected = bruteForce(positions[i]);
+
+        int bestCol = results[i].bestCol;
+        if (!results[i].valid || bestCol < 0) {
+            printf("%s: no best column\n", moves[i].c_str());
+            mismatches++;
+            continue;
+        }
+
+        //the best column has to actually reach the score it was given
+        SolverPosition child = positions[i];
+        int viaBest;
+        if (isWinningMove(child, bestCol)) {
+            viaBest = winScore - (child.moves + 1);
+        } else {
+            child.play(bestCol);
+            viaBest = -bruteForce(child);
+        }
+
+        if (results[i].score != expected || viaBest != expected) {
+            printf("%s: got score %d col %d (worth %d), expected %d\n", moves[i].c_str(),
+                   results[i].score, bestCol + 1, viaBest, expected);
+            mismatches++;
+        }
+    }
+
+    printf("%d known positions wrong, %d of %d random positions wrong\n", failures, mismatches, (int) positions.size());
+    return (failures + mismatches) == 0 ? 0 : 1;
+}